@@ -0,0 +1,330 @@
+#include "Analysis.h"
+#include "Log.h"
+
+#include <doctest/doctest.h>
+#include <fmt/core.h>
+#include <limits>
+#include <utility>
+
+bool is_walkable(Tile tile) {
+    switch (tile) {
+    case Tile::Room:
+    case Tile::Corridor:
+    case Tile::Door:
+        return true;
+    case Tile::None:
+    case Tile::NextToRoom:
+    case Tile::Corner:
+        return false;
+    default:
+        l::error("unhandled tile type in is_walkable: {}", int(tile));
+        return false;
+    }
+}
+
+/**
+ * @brief Finds the root of a provisional label, halving the path on the way.
+ * @param parents union-find forest, parents[label] == label for roots
+ * @param label label to find the root of
+ */
+static uint32_t find_root(std::vector<uint32_t>& parents, uint32_t label) {
+    while (parents[label] != label) {
+        parents[label] = parents[parents[label]];
+        label = parents[label];
+    }
+    return label;
+}
+
+/**
+ * @brief Merges the sets of two provisional labels, keeping the smaller root.
+ * @return the root of the merged set
+ */
+static uint32_t unite(std::vector<uint32_t>& parents, uint32_t a, uint32_t b) {
+    a = find_root(parents, a);
+    b = find_root(parents, b);
+    if (a > b) {
+        std::swap(a, b);
+    }
+    parents[b] = a;
+    return a;
+}
+
+Error label_components(const Grid2D& grid, Connectivity& result) {
+    if (grid.width() * grid.height() >= std::numeric_limits<uint32_t>::max()) {
+        return { fmt::format("grid of {}x{} tiles is too large to label", grid.width(), grid.height()) };
+    }
+    result.labels.reset(grid.width(), grid.height(), no_component);
+    result.n_components = 0;
+    result.component_sizes.clear();
+    result.component_doors.clear();
+
+    // provisional labels start at 1, so index 0 stays no_component
+    std::vector<uint32_t> parents { no_component };
+
+    // first pass: give each walkable tile the label of its already visited
+    // neighbors (previous x and previous y), merging them if they differ.
+    // x is the outer loop since grid[x] is the contiguous row.
+    for (size_t x = 0; x < grid.width(); ++x) {
+        for (size_t y = 0; y < grid.height(); ++y) {
+            if (!is_walkable(grid[x][y])) {
+                continue;
+            }
+            const uint32_t prev_x = x > 0 ? result.labels.at(x - 1, y) : no_component;
+            const uint32_t prev_y = y > 0 ? result.labels.at(x, y - 1) : no_component;
+
+            if (prev_x == no_component && prev_y == no_component) {
+                const auto label = uint32_t(parents.size());
+                parents.push_back(label);
+                result.labels.at(x, y) = label;
+            } else if (prev_x == no_component) {
+                result.labels.at(x, y) = prev_y;
+            } else if (prev_y == no_component) {
+                result.labels.at(x, y) = prev_x;
+            } else {
+                result.labels.at(x, y) = unite(parents, prev_x, prev_y);
+            }
+        }
+    }
+
+    // map each root to a dense, 1-based final label
+    std::vector<uint32_t> final_labels(parents.size(), no_component);
+    for (uint32_t label = 1; label < parents.size(); ++label) {
+        if (find_root(parents, label) == label) {
+            final_labels[label] = uint32_t(++result.n_components);
+        }
+    }
+    result.component_sizes.assign(result.n_components, 0);
+    result.component_doors.assign(result.n_components, 0);
+
+    // second pass: resolve provisional labels and count tiles per component
+    for (size_t x = 0; x < grid.width(); ++x) {
+        for (size_t y = 0; y < grid.height(); ++y) {
+            auto& label = result.labels.at(x, y);
+            if (label == no_component) {
+                continue;
+            }
+            label = final_labels[find_root(parents, label)];
+            if (label == no_component) {
+                return { fmt::format("tile {},{} has no final component label", x, y) };
+            }
+            result.component_sizes[label - 1]++;
+            if (grid[x][y] == Tile::Door) {
+                result.component_doors[label - 1]++;
+            }
+        }
+    }
+
+    return {};
+}
+
+Error compute_reachability(const Grid2D& grid, size_t start_x, size_t start_y, Reachability& result) {
+    if (start_x >= grid.width() || start_y >= grid.height()) {
+        return { fmt::format("start tile {},{} is out of bounds", start_x, start_y) };
+    }
+    if (!is_walkable(grid[start_x][start_y])) {
+        return { fmt::format("start tile {},{} is not walkable", start_x, start_y) };
+    }
+
+    result.distances.reset(grid.width(), grid.height(), unreachable);
+    result.reachable_tiles = 0;
+    result.n_doors = 0;
+    result.reachable_doors = 0;
+
+    for (size_t x = 0; x < grid.width(); ++x) {
+        for (size_t y = 0; y < grid.height(); ++y) {
+            if (grid[x][y] == Tile::Door) {
+                result.n_doors++;
+            }
+        }
+    }
+
+    // breadth-first search; every tile is queued at most once, so the
+    // vector is used as a queue and never shrinks.
+    std::vector<std::pair<size_t, size_t>> queue;
+    queue.reserve(grid.width() * grid.height());
+    queue.emplace_back(start_x, start_y);
+    result.distances.at(start_x, start_y) = 0;
+
+    for (size_t head = 0; head < queue.size(); ++head) {
+        const auto [x, y] = queue[head];
+        const uint32_t distance = result.distances.at(x, y);
+
+        result.reachable_tiles++;
+        if (grid[x][y] == Tile::Door) {
+            result.reachable_doors++;
+        }
+
+        const auto visit = [&](size_t next_x, size_t next_y) {
+            if (result.distances.at(next_x, next_y) == unreachable && is_walkable(grid[next_x][next_y])) {
+                result.distances.at(next_x, next_y) = distance + 1;
+                queue.emplace_back(next_x, next_y);
+            }
+        };
+        if (x > 0) {
+            visit(x - 1, y);
+        }
+        if (x + 1 < grid.width()) {
+            visit(x + 1, y);
+        }
+        if (y > 0) {
+            visit(x, y - 1);
+        }
+        if (y + 1 < grid.height()) {
+            visit(x, y + 1);
+        }
+    }
+
+    return {};
+}
+
+bool find_first_walkable(const Grid2D& grid, size_t& x, size_t& y) {
+    for (x = 0; x < grid.width(); ++x) {
+        for (y = 0; y < grid.height(); ++y) {
+            if (is_walkable(grid[x][y])) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+Error check_connected(const Grid2D& grid) {
+    Connectivity connectivity;
+    auto err = label_components(grid, connectivity);
+    if (err) {
+        return err;
+    }
+
+    size_t start_x = 0;
+    size_t start_y = 0;
+    if (!find_first_walkable(grid, start_x, start_y)) {
+        return { "dungeon has no walkable tiles" };
+    }
+    if (connectivity.n_components > 1) {
+        // every door is walkable, so doors are cut off exactly when they're in another component
+        const uint32_t start_label = connectivity.labels.at(start_x, start_y);
+        size_t n_doors = 0;
+        for (auto doors : connectivity.component_doors) {
+            n_doors += doors;
+        }
+        const size_t cut_off_doors = n_doors - connectivity.component_doors[start_label - 1];
+        return { fmt::format("dungeon has {} areas which are unreachable from each other, {} of {} doors are unreachable from {},{}",
+            connectivity.n_components, cut_off_doors, n_doors, start_x, start_y) };
+    }
+    return {};
+}
+
+/**
+ * @brief Builds a grid from rows of characters, for tests.
+ * '.' is None, 'R' Room, 'C' Corridor, 'D' Door, '#' NextToRoom.
+ * Row i is y = i, column j is x = j.
+ */
+static Grid2D grid_from_rows(const std::vector<std::string>& rows) {
+    Grid2D grid;
+    grid.fill(Tile::None);
+    for (size_t y = 0; y < rows.size(); ++y) {
+        for (size_t x = 0; x < rows[y].size(); ++x) {
+            switch (rows[y][x]) {
+            case 'R':
+                grid[x][y] = Tile::Room;
+                break;
+            case 'C':
+                grid[x][y] = Tile::Corridor;
+                break;
+            case 'D':
+                grid[x][y] = Tile::Door;
+                break;
+            case '#':
+                grid[x][y] = Tile::NextToRoom;
+                break;
+            default:
+                break;
+            }
+        }
+    }
+    return grid;
+}
+
+TEST_CASE("label_components") {
+    Connectivity connectivity;
+
+    SUBCASE("empty grid has no components") {
+        Grid2D grid = grid_from_rows({});
+        REQUIRE_FALSE(label_components(grid, connectivity));
+        CHECK(connectivity.n_components == 0);
+        CHECK(connectivity.labels.at(0, 0) == no_component);
+    }
+    SUBCASE("U-shape is merged into one component") {
+        // both arms get separate provisional labels, which are only merged at the bottom
+        Grid2D grid = grid_from_rows({
+            "R.C",
+            "R.C",
+            "RDC",
+        });
+        REQUIRE_FALSE(label_components(grid, connectivity));
+        CHECK(connectivity.n_components == 1);
+        CHECK(connectivity.component_sizes == std::vector<size_t> { 7 });
+        CHECK(connectivity.component_doors == std::vector<size_t> { 1 });
+        CHECK(connectivity.labels.at(0, 0) == connectivity.labels.at(2, 0));
+        CHECK(connectivity.labels.at(1, 0) == no_component);
+    }
+    SUBCASE("isolated door is its own component") {
+        Grid2D grid = grid_from_rows({
+            "RR#D",
+            "RR#.",
+        });
+        REQUIRE_FALSE(label_components(grid, connectivity));
+        CHECK(connectivity.n_components == 2);
+        CHECK(connectivity.component_sizes == std::vector<size_t> { 4, 1 });
+        CHECK(connectivity.component_doors == std::vector<size_t> { 0, 1 });
+        CHECK(connectivity.labels.at(3, 0) == 2);
+    }
+}
+
+TEST_CASE("compute_reachability") {
+    Grid2D grid = grid_from_rows({
+        "R.C.D",
+        "R.C..",
+        "RDC..",
+    });
+    Reachability reachability;
+
+    SUBCASE("distances along the U-shape") {
+        REQUIRE_FALSE(compute_reachability(grid, 0, 0, reachability));
+        CHECK(reachability.distances.at(0, 0) == 0);
+        CHECK(reachability.distances.at(0, 2) == 2);
+        CHECK(reachability.distances.at(1, 2) == 3);
+        CHECK(reachability.distances.at(2, 0) == 6);
+        CHECK(reachability.distances.at(1, 0) == unreachable);
+        CHECK(reachability.distances.at(4, 0) == unreachable);
+        CHECK(reachability.reachable_tiles == 7);
+        CHECK(reachability.n_doors == 2);
+        CHECK(reachability.reachable_doors == 1);
+    }
+    SUBCASE("out of bounds start tile") {
+        CHECK(compute_reachability(grid, grid.width(), 0, reachability));
+        CHECK(compute_reachability(grid, 0, grid.height(), reachability));
+    }
+    SUBCASE("non-walkable start tile") {
+        CHECK(compute_reachability(grid, 1, 0, reachability));
+    }
+}
+
+TEST_CASE("find_first_walkable") {
+    size_t x = 0;
+    size_t y = 0;
+    CHECK_FALSE(find_first_walkable(grid_from_rows({}), x, y));
+    REQUIRE(find_first_walkable(grid_from_rows({ "..#", ".C." }), x, y));
+    CHECK(x == 1);
+    CHECK(y == 1);
+}
+
+TEST_CASE("check_connected") {
+    CHECK(check_connected(grid_from_rows({})));
+    CHECK_FALSE(check_connected(grid_from_rows({ "RDC" })));
+    CHECK(check_connected(grid_from_rows({ "RDC.R" })));
+
+    const auto err = check_connected(grid_from_rows({ "RD.D", "...D" }));
+    CHECK(err);
+    CHECK(err.msg.find("2 of 3 doors") != std::string::npos);
+}
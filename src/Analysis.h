@@ -0,0 +1,105 @@
+#pragma once
+
+#include "Common.h"
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+/**
+ * Component label of tiles which can't be walked on.
+ */
+constexpr uint32_t no_component = 0;
+
+/**
+ * Distance of tiles which can't be reached from the start tile.
+ */
+constexpr uint32_t unreachable = std::numeric_limits<uint32_t>::max();
+
+/**
+ * @brief One value per tile of a grid, stored on the heap and sized from the grid,
+ * so analysis results stay cheap to hold for large grids.
+ * Indexed like the grid, with `at(x, y)` corresponding to `grid[x][y]`.
+ */
+template<typename T>
+struct TileValues {
+    size_t width { 0 };
+    size_t height { 0 };
+    std::vector<T> values;
+
+    void reset(size_t w, size_t h, const T& value) {
+        width = w;
+        height = h;
+        values.assign(w * h, value);
+    }
+    T& at(size_t x, size_t y) { return values[x * height + y]; }
+    const T& at(size_t x, size_t y) const { return values[x * height + y]; }
+};
+
+/**
+ * @brief Result of labeling the connected walkable areas of a grid.
+ */
+struct Connectivity {
+    // component of each tile, 1-based, or no_component if not walkable
+    TileValues<uint32_t> labels;
+    // number of connected components
+    size_t n_components { 0 };
+    // number of tiles in each component, indexed by label - 1
+    std::vector<size_t> component_sizes;
+    // number of doors in each component, indexed by label - 1
+    std::vector<size_t> component_doors;
+};
+
+/**
+ * @brief Result of a breadth-first walk from a start tile.
+ */
+struct Reachability {
+    // steps from the start tile, or unreachable
+    TileValues<uint32_t> distances;
+    // number of walkable tiles reached, including the start
+    size_t reachable_tiles { 0 };
+    // number of doors in the whole grid
+    size_t n_doors { 0 };
+    // number of doors reached from the start tile
+    size_t reachable_doors { 0 };
+};
+
+/**
+ * @brief Whether a tile can be walked on (rooms, corridors and doors).
+ */
+bool is_walkable(Tile tile);
+
+/**
+ * @brief Labels the 4-connected components of walkable tiles in the grid.
+ * Uses a single scanline pass with union-find, followed by a relabeling pass,
+ * so it runs in (nearly) linear time in the number of tiles.
+ * @param grid grid to analyze
+ * @param result labels, component count and per-component sizes
+ * @return error if something went wrong
+ */
+Error label_components(const Grid2D& grid, Connectivity& result);
+
+/**
+ * @brief Computes the walking distance from a start tile to every tile of the grid,
+ * and how many doors can be reached from it.
+ * @param grid grid to analyze
+ * @param start_x x of the start tile, has to be walkable
+ * @param start_y y of the start tile, has to be walkable
+ * @param result distance field and reachability counts
+ * @return error if the start tile is out of bounds or not walkable
+ */
+Error compute_reachability(const Grid2D& grid, size_t start_x, size_t start_y, Reachability& result);
+
+/**
+ * @brief Finds the first walkable tile of the grid, in the order the grid is stored.
+ * @return false if the grid has no walkable tiles
+ */
+bool find_first_walkable(const Grid2D& grid, size_t& x, size_t& y);
+
+/**
+ * @brief Checks that all walkable tiles, and so all doors, are reachable from each other.
+ * Meant to reject broken dungeons before they are used.
+ * @param grid grid to check
+ * @return error saying how many areas and doors are cut off, if any
+ */
+Error check_connected(const Grid2D& grid);
@@ -0,0 +1,618 @@
+#include "Cache.h"
+#include "Generation.h"
+#include "Log.h"
+#include "Rendering.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <doctest/doctest.h>
+#include <exception>
+#include <fmt/core.h>
+#include <fstream>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+// identifies grid files, and their format version
+static constexpr std::array<char, 4> grid_file_magic { 'D', 'G', 'C', '1' };
+
+// temporary files are written into this subdirectory of the cache, which
+// eviction never looks at, and renamed into the cache once complete
+static constexpr const char* temporary_directory_name = "tmp";
+
+// temporary files older than this were left behind by a crashed writer
+static constexpr auto stale_temporary_age = std::chrono::hours(1);
+
+// upper bound for warm-up threads, regardless of what was asked for
+static constexpr size_t max_warm_up_threads = 256;
+
+// every PNG file starts with this signature, and ends with an empty IEND chunk
+static constexpr std::array<uint8_t, 8> png_signature { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+static constexpr std::array<uint8_t, 12> png_end { 0, 0, 0, 0, 'I', 'E', 'N', 'D', 0xae, 0x42, 0x60, 0x82 };
+
+/**
+ * @brief Incremental 64-bit FNV-1a hash, used to content-address cache entries.
+ * Values are hashed as fixed-width little-endian integers, so keys don't depend
+ * on the platform's integer sizes.
+ */
+struct KeyHasher {
+    uint64_t hash { 0xcbf29ce484222325 };
+
+    KeyHasher& add(uint64_t value) {
+        for (size_t i = 0; i < sizeof(value); ++i) {
+            hash ^= (value >> (i * 8)) & 0xff;
+            hash *= 0x100000001b3;
+        }
+        return *this;
+    }
+
+    std::string str() const {
+        return fmt::format("{:016x}", hash);
+    }
+};
+
+static KeyHasher grid_key(uint32_t seed, size_t n_rooms) {
+    KeyHasher hasher;
+    hasher.add(generator_version).add(seed).add(n_rooms);
+    hasher.add(Grid2D {}.width()).add(Grid2D {}.height());
+    return hasher;
+}
+
+static KeyHasher image_key(uint32_t seed, size_t n_rooms, size_t scale, bool use_textures) {
+    return grid_key(seed, n_rooms).add(renderer_version).add(scale).add(use_textures);
+}
+
+/**
+ * @brief Returns a unique path in the temporary directory for the cache entry at `path`,
+ * so that concurrent writers (threads or processes) never write to the same file.
+ * The result has no extension, so callers can append one.
+ */
+static fs::path temporary_path_for(const fs::path& path) {
+    static std::atomic<size_t> counter { 0 };
+    const auto name = fmt::format("{}-{}-{}", path.filename().string(), boost::this_process::get_id(), counter++);
+    return path.parent_path() / temporary_directory_name / name;
+}
+
+/**
+ * @brief Whether the file is a complete cache entry (as opposed to a temporary file).
+ */
+static bool is_entry(const fs::path& path) {
+    return path.extension() == ".grid" || path.extension() == ".png";
+}
+
+/**
+ * @brief Removes temporary files which were left behind by crashed writers.
+ * Recent ones are kept, since other processes may still be writing them.
+ */
+static void remove_stale_temporary_files(const fs::path& temporary_directory) {
+    const auto now = fs::file_time_type::clock::now();
+    std::error_code ec;
+    for (auto it = fs::directory_iterator(temporary_directory, ec); !ec && it != fs::directory_iterator(); it.increment(ec)) {
+        std::error_code entry_ec;
+        const auto last_write = it->last_write_time(entry_ec);
+        if (!entry_ec && now - last_write > stale_temporary_age) {
+            l::info("removing stale temporary cache file '{}'", it->path().string());
+            fs::remove(it->path(), entry_ec);
+        }
+    }
+}
+
+/**
+ * @brief Flushes a file's contents to disk, so that after renaming it into the cache,
+ * a crash can't leave an empty or truncated file under the final name.
+ */
+static Error sync_file(const fs::path& path) {
+#ifndef _WIN32
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return { fmt::format("failed to open '{}' for syncing", path.string()) };
+    }
+    const int ret = ::fsync(fd);
+    ::close(fd);
+    if (ret != 0) {
+        return { fmt::format("failed to sync '{}' to disk", path.string()) };
+    }
+#else
+    (void)path;
+#endif
+    return {};
+}
+
+/**
+ * @brief Checks that the file at `path` looks like a complete PNG file,
+ * by its signature and its final IEND chunk.
+ */
+static bool is_complete_png(const fs::path& path) {
+    std::error_code ec;
+    const auto size = fs::file_size(path, ec);
+    if (ec || size < png_signature.size() + png_end.size()) {
+        return false;
+    }
+    std::ifstream file(path, std::ios::binary);
+    std::array<char, png_signature.size()> signature {};
+    file.read(signature.data(), signature.size());
+    std::array<char, png_end.size()> end {};
+    file.seekg(-std::streamoff(end.size()), std::ios::end);
+    file.read(end.data(), end.size());
+    return file
+        && std::equal(signature.begin(), signature.end(), png_signature.begin(), [](char a, uint8_t b) { return uint8_t(a) == b; })
+        && std::equal(end.begin(), end.end(), png_end.begin(), [](char a, uint8_t b) { return uint8_t(a) == b; });
+}
+
+static Error write_grid(const Grid2D& grid, const fs::path& path) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        return { fmt::format("failed to open '{}' for writing", path.string()) };
+    }
+    file.write(grid_file_magic.data(), grid_file_magic.size());
+    for (size_t x = 0; x < grid.width(); ++x) {
+        for (size_t y = 0; y < grid.height(); ++y) {
+            file.put(char(grid[x][y]));
+        }
+    }
+    file.close();
+    if (!file) {
+        return { fmt::format("failed to write '{}'", path.string()) };
+    }
+    return {};
+}
+
+static Error read_grid(Grid2D& grid, const fs::path& path) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return { fmt::format("failed to open '{}' for reading", path.string()) };
+    }
+    std::array<char, grid_file_magic.size()> magic {};
+    file.read(magic.data(), magic.size());
+    if (!file || magic != grid_file_magic) {
+        return { fmt::format("'{}' is not a grid file", path.string()) };
+    }
+    for (size_t x = 0; x < grid.width(); ++x) {
+        for (size_t y = 0; y < grid.height(); ++y) {
+            const int tile = file.get();
+            if (tile < int(Tile::None) || tile > int(Tile::Corner)) {
+                return { fmt::format("'{}' is truncated or has invalid tiles", path.string()) };
+            }
+            grid[x][y] = Tile(tile);
+        }
+    }
+    return {};
+}
+
+DungeonCache::DungeonCache(const fs::path& directory, uintmax_t max_bytes)
+    : directory(directory)
+    , max_bytes(max_bytes) {
+    std::error_code ec;
+    fs::create_directories(directory / temporary_directory_name, ec);
+    if (ec) {
+        l::error("failed to create cache directory '{}': {}", directory.string(), ec.message());
+    }
+    remove_stale_temporary_files(directory / temporary_directory_name);
+    std::scoped_lock lock(eviction_mutex);
+    evict();
+}
+
+fs::path DungeonCache::grid_path(uint32_t seed, size_t n_rooms) const {
+    return directory / (grid_key(seed, n_rooms).str() + ".grid");
+}
+
+fs::path DungeonCache::image_path(uint32_t seed, size_t n_rooms, size_t scale, bool use_textures) const {
+    return directory / (image_key(seed, n_rooms, scale, use_textures).str() + ".png");
+}
+
+Error DungeonCache::load_or_generate(Grid2D& grid, uint32_t seed, size_t n_rooms) {
+    const auto path = grid_path(seed, n_rooms);
+
+    std::error_code ec;
+    if (fs::exists(path, ec)) {
+        auto err = read_grid(grid, path);
+        if (!err) {
+            // mark as recently used
+            fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+            return {};
+        }
+        l::warning("ignoring broken cache entry: {}", err.msg);
+        fs::remove(path, ec);
+    }
+
+    grid.fill(Tile::None);
+    auto err = generate(grid, n_rooms, seed);
+    if (err) {
+        return err;
+    }
+
+    const auto temporary = temporary_path_for(path);
+    err = write_grid(grid, temporary);
+    if (!err) {
+        err = sync_file(temporary);
+    }
+    if (!err) {
+        std::error_code rename_ec;
+        fs::rename(temporary, path, rename_ec);
+        if (rename_ec) {
+            err = { fmt::format("failed to move '{}' into place: {}", temporary.string(), rename_ec.message()) };
+        }
+    }
+    if (err) {
+        l::warning("failed to cache dungeon for seed {}: {}", seed, err.msg);
+        fs::remove(temporary, ec);
+        return {};
+    }
+    const auto size = fs::file_size(path, ec);
+    if (!ec) {
+        added(size);
+    }
+    return {};
+}
+
+Error DungeonCache::ensure_rendered(const Grid2D& grid, const fs::path& path, size_t scale, bool use_textures) {
+    std::error_code ec;
+    if (fs::exists(path, ec)) {
+        if (is_complete_png(path)) {
+            // mark as recently used
+            fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+            return {};
+        }
+        l::warning("ignoring broken cache entry: '{}' is not a complete PNG file", path.string());
+        fs::remove(path, ec);
+    }
+
+    // render appends the extension itself
+    const auto temporary = temporary_path_for(path);
+    try {
+        auto err = render(grid, temporary.string(), scale, use_textures, false);
+        if (err) {
+            return err;
+        }
+    } catch (const std::exception& e) {
+        return { fmt::format("failed to render: {}", e.what()) };
+    }
+
+    const auto temporary_file = temporary.string() + ".png";
+    auto err = sync_file(temporary_file);
+    if (err) {
+        fs::remove(temporary_file, ec);
+        return err;
+    }
+    std::error_code rename_ec;
+    fs::rename(temporary_file, path, rename_ec);
+    if (rename_ec) {
+        fs::remove(temporary_file, ec);
+        return { fmt::format("failed to move '{}' into place: {}", temporary_file, rename_ec.message()) };
+    }
+    const auto size = fs::file_size(path, ec);
+    if (!ec) {
+        added(size);
+    }
+    return {};
+}
+
+Error DungeonCache::load_or_render(const Grid2D& grid, uint32_t seed, size_t n_rooms, const std::string& filename,
+    size_t scale, bool use_textures, bool open_viewer) {
+    const auto path = image_path(seed, n_rooms, scale, use_textures);
+    auto err = ensure_rendered(grid, path, scale, use_textures);
+    if (err) {
+        return err;
+    }
+
+    std::error_code ec;
+    fs::copy_file(path, filename + ".png", fs::copy_options::overwrite_existing, ec);
+    if (ec == std::errc::no_such_file_or_directory) {
+        // evicted by another thread or process since it was rendered, so render
+        // directly instead of going through the cache again
+        l::info("cached image was evicted, rendering '{}.png' directly", filename);
+        try {
+            return render(grid, filename, scale, use_textures, open_viewer);
+        } catch (const std::exception& e) {
+            return { fmt::format("failed to render: {}", e.what()) };
+        }
+    }
+    if (ec) {
+        return { fmt::format("failed to copy cached image to '{}.png': {}", filename, ec.message()) };
+    }
+    l::info("wrote cached image to '{}.png'", filename);
+
+    if (open_viewer) {
+        open_image(filename);
+    }
+    return {};
+}
+
+Error DungeonCache::warm_up(uint32_t first_seed, uint32_t last_seed, size_t n_rooms, size_t n_threads,
+    size_t render_scale, bool use_textures) {
+    if (first_seed > last_seed) {
+        return { fmt::format("invalid seed range {}..{}", first_seed, last_seed) };
+    }
+    if (n_threads < 1) {
+        return { "warm-up needs at least one thread" };
+    }
+    // more threads than seeds would only sit idle
+    const uint64_t n_seeds = uint64_t(last_seed) - first_seed + 1;
+    n_threads = size_t(std::min<uint64_t>({ n_threads, n_seeds, max_warm_up_threads }));
+
+    // 64-bit, so the counter can't wrap around when last_seed is the largest seed
+    std::atomic<uint64_t> next_seed { first_seed };
+    std::atomic<size_t> n_failed { 0 };
+    std::mutex first_error_mutex;
+    Error first_error;
+
+    const auto work = [&] {
+        Grid2D grid;
+        for (uint64_t seed = next_seed++; seed <= last_seed; seed = next_seed++) {
+            auto err = load_or_generate(grid, uint32_t(seed), n_rooms);
+            if (!err && render_scale != 0) {
+                err = ensure_rendered(grid, image_path(uint32_t(seed), n_rooms, render_scale, use_textures), render_scale, use_textures);
+            }
+            if (err) {
+                n_failed++;
+                std::scoped_lock lock(first_error_mutex);
+                if (!first_error) {
+                    first_error = { fmt::format("seed {}: {}", seed, err.msg) };
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    Error spawn_error;
+    try {
+        for (size_t i = 0; i < n_threads; ++i) {
+            threads.emplace_back(work);
+        }
+    } catch (const std::system_error& e) {
+        // the running threads reference this stack frame, so stop them and
+        // wait for them before returning
+        spawn_error = { fmt::format("failed to start warm-up thread {} of {}: {}", threads.size() + 1, n_threads, e.what()) };
+        next_seed = uint64_t(last_seed) + 1;
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    if (spawn_error) {
+        return spawn_error;
+    }
+    if (first_error) {
+        return { fmt::format("{} dungeon(s) failed to warm up, first: {}", n_failed.load(), first_error.msg) };
+    }
+    l::info("warmed up cache for seeds {}..{}", first_seed, last_seed);
+    return {};
+}
+
+void DungeonCache::added(uintmax_t bytes) {
+    std::scoped_lock lock(eviction_mutex);
+    total_bytes += bytes;
+    if (total_bytes > max_bytes) {
+        evict();
+    }
+}
+
+void DungeonCache::evict() {
+    struct Entry {
+        fs::path path;
+        fs::file_time_type last_used;
+        uintmax_t size;
+    };
+
+    // other processes may have added or removed entries, so always rescan
+    std::vector<Entry> entries;
+    total_bytes = 0;
+    std::error_code ec;
+    for (auto it = fs::directory_iterator(directory, ec); !ec && it != fs::directory_iterator(); it.increment(ec)) {
+        std::error_code entry_ec;
+        if (!it->is_regular_file(entry_ec) || !is_entry(it->path())) {
+            continue;
+        }
+        const auto size = it->file_size(entry_ec);
+        const auto last_used = it->last_write_time(entry_ec);
+        if (entry_ec) {
+            // removed by someone else while scanning
+            continue;
+        }
+        entries.push_back({ it->path(), last_used, size });
+        total_bytes += size;
+    }
+
+    if (total_bytes <= max_bytes) {
+        return;
+    }
+
+    // evict down to 90% of the limit, so a full cache isn't rescanned on every new entry
+    const uintmax_t target_bytes = max_bytes / 10 * 9;
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {
+        return a.last_used < b.last_used;
+    });
+    size_t n_evicted = 0;
+    for (const auto& entry : entries) {
+        if (total_bytes <= target_bytes) {
+            break;
+        }
+        fs::remove(entry.path, ec);
+        total_bytes -= entry.size;
+        n_evicted++;
+    }
+    l::info("evicted {} cache entries, {} bytes left", n_evicted, total_bytes);
+}
+
+/**
+ * @brief An empty, unique directory for a test, removed again when destroyed.
+ */
+struct TestDirectory {
+    fs::path path;
+
+    TestDirectory() {
+        static std::atomic<size_t> counter { 0 };
+        path = fs::temp_directory_path() / fmt::format("dun-gen-test-{}-{}", boost::this_process::get_id(), counter++);
+        fs::remove_all(path);
+        fs::create_directories(path);
+    }
+    ~TestDirectory() {
+        std::error_code ec;
+        fs::remove_all(path, ec);
+    }
+};
+
+static uintmax_t entries_size(const fs::path& directory) {
+    uintmax_t size = 0;
+    for (const auto& entry : fs::directory_iterator(directory)) {
+        if (entry.is_regular_file() && is_entry(entry.path())) {
+            size += entry.file_size();
+        }
+    }
+    return size;
+}
+
+TEST_CASE("grid files") {
+    TestDirectory dir;
+    const auto path = dir.path / "test.grid";
+
+    Grid2D grid;
+    grid.fill(Tile::None);
+    grid[1][2] = Tile::Room;
+    grid[3][4] = Tile::Door;
+    grid[19][19] = Tile::Corner;
+    REQUIRE_FALSE(write_grid(grid, path));
+
+    SUBCASE("round trip") {
+        Grid2D read;
+        REQUIRE_FALSE(read_grid(read, path));
+        CHECK(read == grid);
+    }
+    SUBCASE("truncated file is rejected") {
+        fs::resize_file(path, fs::file_size(path) - 1);
+        Grid2D read;
+        CHECK(read_grid(read, path));
+    }
+    SUBCASE("bad magic is rejected") {
+        std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+        file.put('X');
+        file.close();
+        Grid2D read;
+        CHECK(read_grid(read, path));
+    }
+    SUBCASE("missing file is rejected") {
+        Grid2D read;
+        CHECK(read_grid(read, dir.path / "missing.grid"));
+    }
+}
+
+TEST_CASE("cache keys and generation are deterministic") {
+    TestDirectory dir;
+    DungeonCache cache(dir.path, 1024 * 1024);
+
+    CHECK(grid_key(42, 5).str() == grid_key(42, 5).str());
+    CHECK(grid_key(42, 5).str() != grid_key(43, 5).str());
+    CHECK(grid_key(42, 5).str() != grid_key(42, 6).str());
+    CHECK(image_key(42, 5, 1, true).str() == image_key(42, 5, 1, true).str());
+    CHECK(image_key(42, 5, 1, true).str() != image_key(42, 5, 2, true).str());
+    CHECK(image_key(42, 5, 1, true).str() != image_key(42, 5, 1, false).str());
+    const auto path = dir.path / (grid_key(42, 5).str() + ".grid");
+
+    Grid2D generated;
+    generated.fill(Tile::None);
+    REQUIRE_FALSE(generate(generated, 5, 42));
+
+    Grid2D first;
+    REQUIRE_FALSE(cache.load_or_generate(first, 42, 5));
+    CHECK(first == generated);
+    CHECK(fs::exists(path));
+
+    Grid2D second;
+    REQUIRE_FALSE(cache.load_or_generate(second, 42, 5));
+    CHECK(second == generated);
+
+    SUBCASE("broken entries are regenerated") {
+        fs::resize_file(path, 2);
+        Grid2D regenerated;
+        REQUIRE_FALSE(cache.load_or_generate(regenerated, 42, 5));
+        CHECK(regenerated == generated);
+    }
+}
+
+TEST_CASE("eviction removes least recently used entries first") {
+    TestDirectory dir;
+    const auto now = fs::file_time_type::clock::now();
+    const auto write_file = [&](const fs::path& path, std::chrono::hours age) {
+        std::ofstream(path) << std::string(100, 'x');
+        fs::last_write_time(path, now - age);
+    };
+    fs::create_directories(dir.path / temporary_directory_name);
+    write_file(dir.path / "oldest.grid", std::chrono::hours(3));
+    write_file(dir.path / "middle.png", std::chrono::hours(2));
+    write_file(dir.path / "newest.grid", std::chrono::hours(1));
+    write_file(dir.path / "unrelated.txt", std::chrono::hours(4));
+    write_file(dir.path / temporary_directory_name / "stale", std::chrono::hours(2));
+    write_file(dir.path / temporary_directory_name / "in-progress", std::chrono::hours(0));
+
+    DungeonCache cache(dir.path, 250);
+
+    CHECK_FALSE(fs::exists(dir.path / "oldest.grid"));
+    CHECK(fs::exists(dir.path / "middle.png"));
+    CHECK(fs::exists(dir.path / "newest.grid"));
+    CHECK(fs::exists(dir.path / "unrelated.txt"));
+    CHECK_FALSE(fs::exists(dir.path / temporary_directory_name / "stale"));
+    CHECK(fs::exists(dir.path / temporary_directory_name / "in-progress"));
+    const auto size = entries_size(dir.path);
+    CHECK(size <= 250);
+}
+
+TEST_CASE("parallel warm-up stays within max_bytes") {
+    TestDirectory dir;
+    // small enough that entries are evicted while other threads are still rendering
+    const uintmax_t max_bytes = 4000;
+    DungeonCache cache(dir.path, max_bytes);
+
+    REQUIRE_FALSE(cache.warm_up(0, 63, 5, 8, 1, false));
+    const auto size = entries_size(dir.path);
+    CHECK(size <= max_bytes);
+    CHECK(fs::is_empty(dir.path / temporary_directory_name));
+
+    SUBCASE("load_or_render works for warmed up and evicted entries") {
+        Grid2D grid;
+        const auto output = (dir.path / "output").string();
+        for (uint32_t seed : { 0u, 63u }) {
+            REQUIRE_FALSE(cache.load_or_generate(grid, seed, 5));
+            REQUIRE_FALSE(cache.load_or_render(grid, seed, 5, output, 1, false, false));
+            CHECK(fs::exists(output + ".png"));
+        }
+    }
+}
+
+TEST_CASE("warm-up caps the number of threads") {
+    TestDirectory dir;
+    DungeonCache cache(dir.path, 1024 * 1024);
+
+    // one seed, so this only starts a single thread
+    CHECK_FALSE(cache.warm_up(7, 7, 5, 100000000));
+    CHECK(fs::exists(dir.path / (grid_key(7, 5).str() + ".grid")));
+    CHECK(cache.warm_up(8, 7, 5, 1));
+    CHECK(cache.warm_up(7, 7, 5, 0));
+}
+
+TEST_CASE("broken cached images are rendered again") {
+    TestDirectory dir;
+    DungeonCache cache(dir.path, 1024 * 1024);
+    const auto path = dir.path / (image_key(3, 5, 1, false).str() + ".png");
+    const auto output = (dir.path / "output").string();
+
+    Grid2D grid;
+    REQUIRE_FALSE(cache.load_or_generate(grid, 3, 5));
+    REQUIRE_FALSE(cache.load_or_render(grid, 3, 5, output, 1, false, false));
+    REQUIRE(is_complete_png(path));
+
+    // as if the machine crashed before the data reached the disk
+    fs::resize_file(path, fs::file_size(path) / 2);
+    CHECK_FALSE(is_complete_png(path));
+
+    REQUIRE_FALSE(cache.load_or_render(grid, 3, 5, output, 1, false, false));
+    CHECK(is_complete_png(path));
+    CHECK(is_complete_png(output + ".png"));
+}
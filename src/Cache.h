@@ -0,0 +1,85 @@
+#pragma once
+
+#include "Common.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+
+/**
+ * @brief On-disk cache of generated dungeons and their rendered images.
+ *
+ * Entries are content-addressed by a hash of the seed, the generation parameters,
+ * the grid size and `generator_version`, so a cache directory can be shared between
+ * restarts and between processes. Files are written to a temporary name and renamed
+ * into place, so readers never see partially written entries.
+ *
+ * The total size of the cache is kept below `max_bytes` by removing the least recently
+ * used entries first.
+ */
+class DungeonCache {
+public:
+    /**
+     * @brief Opens (and creates, if needed) a cache in the given directory.
+     * @param directory directory to store cache entries in
+     * @param max_bytes maximum total size of all entries
+     */
+    DungeonCache(const std::filesystem::path& directory, uintmax_t max_bytes);
+
+    /**
+     * @brief Loads the dungeon for the given seed and parameters from the cache,
+     * or generates and stores it if it's not cached yet.
+     * @param grid grid to fill
+     * @param seed seed to generate with
+     * @param n_rooms number of rooms to generate
+     * @return error if generation failed; failing to store in the cache is only logged
+     */
+    Error load_or_generate(Grid2D& grid, uint32_t seed, size_t n_rooms);
+
+    /**
+     * @brief Writes the rendered image of a dungeon to `filename.png`, taking it from the cache
+     * if possible, otherwise rendering it and storing it in the cache.
+     * @param grid grid generated from `seed` and `n_rooms`
+     * @param seed seed the grid was generated with
+     * @param n_rooms number of rooms the grid was generated with
+     * @param filename filename or path with filename to write to, without extension
+     * @param scale see `render`
+     * @param use_textures see `render`
+     * @param open_viewer whether to open the image in the system's image viewer
+     * @return error if rendering or copying the image failed
+     */
+    Error load_or_render(const Grid2D& grid, uint32_t seed, size_t n_rooms, const std::string& filename,
+        size_t scale, bool use_textures, bool open_viewer = true);
+
+    /**
+     * @brief Generates and caches the dungeons for all seeds in `[first_seed, last_seed]`,
+     * in parallel.
+     * @param first_seed first seed of the range
+     * @param last_seed last seed of the range (inclusive)
+     * @param n_rooms number of rooms to generate
+     * @param n_threads number of worker threads (at least 1)
+     * @param render_scale if not 0, also render and cache images at this scale
+     * @param use_textures see `render`, only used if `render_scale` is not 0
+     * @return error if any of the dungeons failed, with the first failure's message
+     */
+    Error warm_up(uint32_t first_seed, uint32_t last_seed, size_t n_rooms, size_t n_threads,
+        size_t render_scale = 0, bool use_textures = true);
+
+private:
+    std::filesystem::path grid_path(uint32_t seed, size_t n_rooms) const;
+    std::filesystem::path image_path(uint32_t seed, size_t n_rooms, size_t scale, bool use_textures) const;
+
+    // renders into the cache if needed, without copying the image anywhere else
+    Error ensure_rendered(const Grid2D& grid, const std::filesystem::path& path, size_t scale, bool use_textures);
+    // records a newly stored entry, and evicts if the cache grew too large
+    void added(uintmax_t bytes);
+    void evict();
+
+    std::filesystem::path directory;
+    uintmax_t max_bytes;
+    // guards total_bytes and eviction
+    std::mutex eviction_mutex;
+    // approximate size of all entries; other processes may change the directory,
+    // so it's recomputed on every eviction
+    uintmax_t total_bytes { 0 };
+};
@@ -4,10 +4,19 @@
 #include <random>
 
 namespace Random {
+// one engine per thread, so dungeons can be generated in parallel
+std::mt19937& engine() {
+    thread_local std::mt19937 mt { std::random_device {}() };
+    return mt;
+}
+
+void seed(uint32_t seed) {
+    engine().seed(seed);
+}
+
 size_t generate(size_t min, size_t max) {
-    static std::mt19937 mt { std::random_device {}() };
     std::uniform_int_distribution distribution { min, max };
-    return distribution(mt);
+    return distribution(engine());
 }
 }
 
@@ -186,3 +195,8 @@ Error generate(Grid2D& grid, size_t n_rooms) {
 
     return {};
 }
+
+Error generate(Grid2D& grid, size_t n_rooms, uint32_t seed) {
+    Random::seed(seed);
+    return generate(grid, n_rooms);
+}
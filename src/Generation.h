@@ -2,4 +2,22 @@
 
 #include "Common.h"
 
+#include <cstdint>
+
+/**
+ * Version of the generation algorithm. Bump this whenever `generate` produces
+ * different dungeons for the same seed and parameters, so cached dungeons
+ * from older versions are no longer used.
+ */
+constexpr uint32_t generator_version = 1;
+
 Error generate(Grid2D& grid, size_t n_rooms);
+
+/**
+ * @brief Generates a dungeon deterministically from the given seed
+ * (on the calling thread, for the same build).
+ * @param grid grid to generate into, expected to be filled with Tile::None
+ * @param n_rooms number of rooms to place
+ * @param seed seed for the random generator
+ */
+Error generate(Grid2D& grid, size_t n_rooms, uint32_t seed);
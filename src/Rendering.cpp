@@ -139,9 +139,11 @@ Error fill_image(STBImage& image, const Grid2D& grid) {
  * @param filename Filename or path with filename to write to, without extension.
  * @param scale Scale to scale the image to (at least 1). With a scale of 2, for example,
  * each grid pixel becomes a 2x2 pixel area in the image.
+ * @param use_textures Whether to draw each tile with its texture instead of a flat color.
+ * @param open_viewer Whether to open the written image in the system's image viewer.
  * @return An error if anything went wrong, explaining the issue in the message field.
  */
-Error render(const Grid2D& grid, const std::string& filename, size_t scale, bool use_textures) {
+Error render(const Grid2D& grid, const std::string& filename, size_t scale, bool use_textures, bool open_viewer) {
     if (scale < 1) {
         l::error("render scale must be >= 1, got {}", scale);
         return { "invalid render scale" };
@@ -194,9 +196,15 @@ Error render(const Grid2D& grid, const std::string& filename, size_t scale, bool
         scaled.write_to_file_png(filename);
     }
 
-    l::info("opening image viewer", filename);
-
-    spawn_process_silently(fmt::format("xdg-open {}.png", filename));
+    if (open_viewer) {
+        open_image(filename);
+    }
 
     return {};
 }
+
+void open_image(const std::string& filename) {
+    l::info("opening '{}.png' in image viewer", filename);
+
+    spawn_process_silently(fmt::format("xdg-open {}.png", filename));
+}
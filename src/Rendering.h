@@ -2,4 +2,18 @@
 
 #include "Common.h"
 
-Error render(const Grid2D& grid, const std::string& filename, size_t scale = 1, bool use_textures = true);
+#include <cstdint>
+
+/**
+ * Version of the renderer. Bump this whenever `render` produces different images for
+ * the same grid, for example when changing tile colors or the textures in assets/tiles,
+ * so cached images from older versions are no longer used.
+ */
+constexpr uint32_t renderer_version = 1;
+
+Error render(const Grid2D& grid, const std::string& filename, size_t scale = 1, bool use_textures = true, bool open_viewer = true);
+
+/**
+ * @brief Opens `filename.png` in the system's image viewer.
+ */
+void open_image(const std::string& filename);
@@ -1,25 +1,126 @@
 #include "Common.h"
+#include <algorithm>
 #include <fmt/core.h>
+#include <limits>
+#include <optional>
+#include <thread>
+#include <vector>
 
+#include "Analysis.h"
+#include "Cache.h"
 #include "Generation.h"
 #include "Log.h"
 #include "Rendering.h"
 
-int main() {
+static constexpr size_t n_rooms = 5;
+static constexpr size_t render_scale = 32;
+static constexpr const char* cache_path = "./cache";
+static constexpr uintmax_t cache_max_bytes = 256 * 1024 * 1024;
+
+static Error parse_seed(const std::string& str, uint32_t& seed) {
+    try {
+        size_t end = 0;
+        const auto value = std::stoull(str, &end);
+        if (end != str.size() || value > std::numeric_limits<uint32_t>::max()) {
+            return { fmt::format("invalid seed '{}'", str) };
+        }
+        seed = uint32_t(value);
+    } catch (const std::exception&) {
+        return { fmt::format("invalid seed '{}'", str) };
+    }
+    return {};
+}
+
+static Error parse_thread_count(const std::string& str, size_t& n_threads) {
+    try {
+        size_t end = 0;
+        const auto value = std::stoull(str, &end);
+        if (end != str.size() || value < 1) {
+            return { fmt::format("invalid thread count '{}', expected a number >= 1", str) };
+        }
+        n_threads = size_t(value);
+    } catch (const std::exception&) {
+        return { fmt::format("invalid thread count '{}', expected a number >= 1", str) };
+    }
+    return {};
+}
+
+/**
+ * usage:
+ *   dun-gen                                generate a random dungeon
+ *   dun-gen <seed>                         generate (or load from cache) the dungeon for a seed
+ *   dun-gen warm-up <first> <last> [n]     cache the dungeons for seeds first..last with n threads
+ */
+int main(int argc, char** argv) {
+    const std::vector<std::string> args(argv + 1, argv + argc);
+
+    if (!args.empty() && args[0] == "warm-up") {
+        uint32_t first_seed = 0;
+        uint32_t last_seed = 0;
+        size_t n_threads = std::max(1u, std::thread::hardware_concurrency());
+        if (args.size() < 3 || args.size() > 4) {
+            l::error("usage: dun-gen warm-up <first seed> <last seed> [threads]");
+            return 1;
+        }
+        auto err = parse_seed(args[1], first_seed);
+        if (!err) {
+            err = parse_seed(args[2], last_seed);
+        }
+        if (!err && args.size() == 4) {
+            err = parse_thread_count(args[3], n_threads);
+        }
+        if (err) {
+            l::error("{}", err.msg);
+            return 1;
+        }
+        DungeonCache cache(cache_path, cache_max_bytes);
+        err = cache.warm_up(first_seed, last_seed, n_rooms, n_threads, render_scale, true);
+        if (err) {
+            l::error("failed to warm up cache: {}\n", err.msg);
+            return 1;
+        }
+        return 0;
+    }
+
+    // only used with an explicit seed, since random dungeons are never requested again
+    std::optional<uint32_t> seed;
+    std::optional<DungeonCache> cache;
+    if (!args.empty()) {
+        uint32_t value = 0;
+        auto err = parse_seed(args[0], value);
+        if (err) {
+            l::error("{}", err.msg);
+            return 1;
+        }
+        seed = value;
+        cache.emplace(cache_path, cache_max_bytes);
+    }
+
     Grid2D grid;
     grid.fill(Tile::None);
 
-    auto err = generate(grid, 5);
+    auto err = seed ? cache->load_or_generate(grid, *seed, n_rooms) : generate(grid, n_rooms);
     if (err) {
         l::error("failed to generate: {}\n", err.msg);
         return 1;
     }
 
+    // FIXME: generate doesn't link rooms with corridors yet, so nearly every dungeon
+    // is disconnected. Only warn for now, instead of refusing to render.
+    err = check_connected(grid);
+    if (err) {
+        l::warning("dungeon is not fully connected: {}", err.msg);
+    }
+
     // TODO: choose rendering mode :-D
 
     const std::string output_file = "output";
 
-    err = render(grid, output_file, 32, true);
+    if (seed) {
+        err = cache->load_or_render(grid, *seed, n_rooms, output_file, render_scale, true);
+    } else {
+        err = render(grid, output_file, render_scale, true);
+    }
     if (err) {
         l::error("failed to render: {}\n", err.msg);
         return 1;